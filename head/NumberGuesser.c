@@ -24,6 +24,15 @@
  * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
 
+#define _POSIX_C_SOURCE 200809L
+
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <limits.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
@@ -36,13 +45,47 @@
 static int play_attempts(void);
 static int play_time(void);
 static int gamemode(void);
-static int difficulty(void);
+static int select_gamemode(char);
+static int difficulty(int);
+static int select_difficulty(char, int);
+static char adaptive_difficulty(int);
 static void write_highscore(int, int, int, int);
+static int lock_score_file(int);
+static int print_scores(char, char, int, int);
+static int parse_difficulty(char);
+static const struct difficulty *find_difficulty(int);
+static const struct difficulty *lookup_difficulty(int);
+static int ingest_scores(const char *);
+static int ingest_line(const char *, const char *, char *, size_t);
+static int parse_score(const char *, const char *, long long *);
+static int scan_number(const char **, const char *, long long *);
+static int simulate(char, int, unsigned int);
+static int simulate_game(int, int, unsigned int *);
+static int hint(int, int, int, int *);
+static void print_hint(int);
+static void narrow(int);
 static void print_help(void);
 static void usage(void)  __attribute__((noreturn));
+static long long clock_ms(void);
+
+/* Difficulty tiers, easiest first */
+static const struct difficulty {
+	char name[7];
+	char selection;
+	int diff, max;
+} difficulties[] = {
+	{ "Easy", 'e', DIFF_EASY, EASY_MAX },
+	{ "Medium", 'm', DIFF_MEDIUM, MEDIUM_MAX },
+	{ "Hard", 'h', DIFF_HARD, HARD_MAX },
+};
+#define NDIFFICULTIES ((int)(sizeof(difficulties) / sizeof(difficulties[0])))
+
+/* Guessing strategies played by simulate() */
+static const char *const strategies[] = { "bisection", "random" };
 
 static int answer, numberwang, num_attempts;
-static double time_spent;
+static int hints, hint_low, hint_high;	/* range the answer can still be in */
+static int time_spent;	/* milliseconds */
 
 /*
  * Main function, initialises random, determines gamemode
@@ -53,24 +96,72 @@ int
 main(int argc, char *argv[])
 {
 	int mode, diff, result, ch;
+	int query = 0, max_time = -1, days = -1, games = 0;
+	unsigned int seed = (unsigned int)(time(NULL));
+	char mode_opt = '\0', diff_opt = '\0';
+	const char *import = NULL;
 	
-	while ((ch = getopt(argc, argv, "hH:")) != -1) {
+	while ((ch = getopt(argc, argv, "hH:m:d:st:w:b:r:i:g")) != -1) {
 		switch (ch) {
 		case 'h':
 			/* FALLTHROUGH */
 		case 'H':
 			print_help();
 			break;
+		case 'm':
+			mode_opt = optarg[0];
+			break;
+		case 'd':
+			diff_opt = optarg[0];
+			break;
+		case 's':
+			query = 1;
+			break;
+		case 't':
+			max_time = atoi(optarg);
+			break;
+		case 'w':
+			days = atoi(optarg);
+			break;
+		case 'b':
+			games = atoi(optarg);
+			if (games < 1)
+				usage();
+			break;
+		case 'r':
+			seed = (unsigned int)strtoul(optarg, NULL, 10);
+			break;
+		case 'i':
+			import = optarg;
+			break;
+		case 'g':
+			hints = 1;
+			break;
 		default:
 			usage();
 		}
 	}
 
+	/* import an old score file instead of playing */
+	if (import != NULL)
+		return ingest_scores(import);
+
+	/* list past scores instead of playing */
+	if (query)
+		return print_scores(mode_opt, diff_opt, max_time, days);
+
 	/* Initialise random number generator */
-	srand((unsigned int)(time(NULL)));
+	srand(seed);
 
-	/* fetch the gamemode from the user */
-	mode = gamemode();
+	/* play simulated games instead of a real one */
+	if (games > 0)
+		return simulate(diff_opt, games, seed);
+
+	/* fetch the gamemode from the command line or the user */
+	if (mode_opt != '\0')
+		mode = select_gamemode(mode_opt);
+	else
+		mode = gamemode();
 	if (mode == EXIT_FAILURE) {
 		return EXIT_FAILURE;
 	} else if (mode == MODE_HELP) {
@@ -78,8 +169,11 @@ main(int argc, char *argv[])
 		return EXIT_SUCCESS;
 	}
 	
-	/* fetch the difficulty from the user */
-	diff = difficulty();
+	/* fetch the difficulty from the command line or the user */
+	if (diff_opt != '\0')
+		diff = select_difficulty(diff_opt, mode);
+	else
+		diff = difficulty(mode);
 	if (diff == EXIT_FAILURE)
 		return EXIT_FAILURE;
 	
@@ -98,7 +192,7 @@ main(int argc, char *argv[])
 
 	if (result == 0) {
 		/* Write score to a file */
-		write_highscore(mode, diff, num_attempts, (int)time_spent);
+		write_highscore(mode, diff, num_attempts, time_spent);
 		return EXIT_SUCCESS;
 	} else {
 		fprintf(stderr, "An unknown error occurred\n");
@@ -114,32 +208,38 @@ static int
 play_attempts()
 {
 	int guess;
-	time_t begin, end;
+	long long begin;
 
 	num_attempts = 1;
 
 	//Start the clock
-	time(&begin);
+	begin = clock_ms();
 
+	print_hint(GUESS_LIMIT);
 	printf("Guess what the secret number is: ");
 	//Read a number in from the keyboard
 	int test = scanf("%d", &guess);
 	if (test != 1) return EXIT_FAILURE;
 
 	while (guess != answer) {
-		if (num_attempts >= 10) {
+		if (num_attempts >= GUESS_LIMIT) {
 			printf("Sorry, you ran out of guesses!\n");
 			printf("The number was: %d\n", answer);
-			time(&end);
-			time_spent = difftime(end,begin);
-			printf("It took you %d seconds\n", (int)time_spent);
+			/* record a loss as one guess over the limit */
+			num_attempts = GUESS_LIMIT + 1;
+			time_spent = (int)(clock_ms() - begin);
+			printf("It took you %d.%03d seconds\n", time_spent / 1000, time_spent % 1000);
 			return EXIT_SUCCESS;
 		}
 
 		if (guess == numberwang) {
 			printf("THAT'S NUMBERWANG!\n");
 			return EXIT_SUCCESS;
-		} if (guess < answer) {
+		}
+
+		narrow(guess);
+		print_hint(GUESS_LIMIT - num_attempts);
+		if (guess < answer) {
 			printf("Too low, try a higher number: ");
 		} else if (guess > answer) {
 			printf("Too high, try a lower number: ");
@@ -153,9 +253,8 @@ play_attempts()
 
 	printf("Correct! The number was: %d\n", answer);
 	printf("It took you %d attempts\n", num_attempts);
-	time(&end);
-	time_spent = difftime(end, begin);
-	printf("It took you %d seconds\n", (int)time_spent);
+	time_spent = (int)(clock_ms() - begin);
+	printf("It took you %d.%03d seconds\n", time_spent / 1000, time_spent % 1000);
 	return EXIT_SUCCESS;
 }
 
@@ -167,13 +266,14 @@ static int
 play_time()
 {
 	int guess, time_left;
-	time_t begin, end;
+	long long begin;
 
 	num_attempts = 1;
 
 	/* Start the clock */
-	time(&begin);
+	begin = clock_ms();
 
+	print_hint(-1);
 	printf("Guess what the secret number is: ");
 
 	/* Read a number in from the keyboard */
@@ -181,16 +281,13 @@ play_time()
 	if (test != 1)
 		return EXIT_FAILURE;
 	while (guess != answer) {
-		time(&end);
-		time_spent = difftime(end,begin);
-		time_left = TIMELIMIT - (int)time_spent;
+		time_spent = (int)(clock_ms() - begin);
+		time_left = TIMELIMIT * 1000 - time_spent;
 
 		if (time_left <= 0) {
 			printf("Sorry, you ran out of time!\n");
 			printf("The number was: %d\n", answer);
-			time(&end);
-			time_spent = difftime(end, begin);
-			printf("It took you %d seconds\n", (int)time_spent);
+			printf("It took you %d.%03d seconds\n", time_spent / 1000, time_spent % 1000);
 			return EXIT_SUCCESS;
 		}
 
@@ -199,10 +296,14 @@ play_time()
 			return EXIT_SUCCESS;
 		}
 
+		narrow(guess);
+		print_hint(-1);
 		if (guess < answer) {
-			printf("Time Left : %2d | Too low, try a higher number: ", time_left);
+			printf("Time Left : %2d | Too low, try a higher number: ",
+			    (time_left + 999) / 1000);
 		} else if (guess > answer) {
-			printf("Time Left : %2d | Too high, try a lower number: ", time_left);
+			printf("Time Left : %2d | Too high, try a lower number: ",
+			    (time_left + 999) / 1000);
 		}
 
 		num_attempts++;
@@ -213,9 +314,8 @@ play_time()
 
 	printf("Correct! The number was: %d\n", answer);
 	printf("It took you %d attempts\n", num_attempts);
-	time(&end);
-	time_spent = difftime(end, begin);
-	printf("It took you %d seconds\n", (int)time_spent);
+	time_spent = (int)(clock_ms() - begin);
+	printf("It took you %d.%03d seconds\n", time_spent / 1000, time_spent % 1000);
 	return EXIT_SUCCESS;
 }
 
@@ -230,7 +330,17 @@ gamemode()
 	char selection;
 	int test = scanf(" %c", &selection);
 	if (test != 1) return EXIT_FAILURE;
-	
+
+	return select_gamemode(selection);
+}
+
+/*
+ * map a gamemode selection character to its MODE_* value
+ * exits if the selection is not a valid gamemode
+ */
+static int
+select_gamemode(char selection)
+{
 	switch (selection) {
 		case 'a':
 		case 'A':
@@ -252,54 +362,686 @@ gamemode()
  * if an error occurs, return EXIT_FAILURE, else EXIT_SUCCESS
  */
 static int
-difficulty()
+difficulty(int mode)
 {
-	printf("Choose a difficulty, (e)asy, (m)edium or (h)ard\n");
+	printf("Choose a difficulty, (e)asy, (m)edium, (h)ard or (a)daptive\n");
 	char selection;
 	int test = scanf(" %c", &selection);
 	if (test != 1)
 		return EXIT_FAILURE;
-	
+
+	return select_difficulty(selection, mode);
+}
+
+/*
+ * map a difficulty selection character to its DIFF_* value
+ * and initialise entropy accordingly
+ * exits if the selection is not a valid difficulty
+ */
+static int
+select_difficulty(char selection, int mode)
+{
+	const struct difficulty *d;
+
+	if (selection == 'a' || selection == 'A')
+		selection = adaptive_difficulty(mode);
+
 	/* Determine difficulty from input, and initialise entropy accordingly */
-	switch (selection) {
-		case 'e':
-		case 'E':
-			answer = rand() % (EASY_MAX + 1);
-			numberwang = rand() % (EASY_MAX + 1);
-			printf("Easy Mode: 0-%d\n", EASY_MAX);
-			return DIFF_EASY;
-		case 'm':
-		case 'M':
-			answer = rand() % (MEDIUM_MAX + 1);
-			numberwang = rand() % (MEDIUM_MAX + 1);
-			printf("Medium Mode: 0-%d\n", MEDIUM_MAX);
-			return DIFF_MEDIUM;
-		case 'h':
-		case 'H':
-			answer = rand() % (HARD_MAX + 1);
-			numberwang = rand() % (HARD_MAX + 1);
-			printf("Hard Mode: 0-%d\n", HARD_MAX);
-			return DIFF_HARD;
+	d = find_difficulty(parse_difficulty(selection));
+	answer = rand() % (d->max + 1);
+	numberwang = rand() % (d->max + 1);
+	hint_high = d->max;
+	printf("%s Mode: 0-%d\n", d->name, d->max);
+	return d->diff;
+}
+
+/*
+ * pick a difficulty from the player's recent results in the score file
+ * only the last ADAPT_WINDOW lines are read, so the cost does not grow
+ * with the length of the score history. Of the last ADAPT_GAMES games
+ * in this gamemode at the most recently played difficulty, easy wins
+ * step the difficulty up and losses step it down. In attempts mode a game
+ * using at most half the guesses is an easy win, and a loss, recorded as
+ * GUESS_LIMIT + 1 attempts, or a win using more than three quarters of
+ * the guesses counts against the player.
+ * In time mode a game over the time limit is a loss and one in under a
+ * third of it an easy win
+ * returns the selection character for the chosen difficulty
+ */
+static char
+adaptive_difficulty(int mode)
+{
+	char buf[SCORE_LINE_MAX * ADAPT_WINDOW + 1];
+	char *line, *end;
+	struct stat sb;
+	off_t off;
+	ssize_t len;
+	long long v[5];
+	int fd, tier = -1, seen = 0, up = 0, down = 0, i;
+
+	fd = open(SCORE_FILE, O_RDONLY);
+	if (fd == -1)
+		return 'e';
+
+	if (fstat(fd, &sb) == -1) {
+		(void)close(fd);
+		return 'e';
 	}
-	
-	fprintf(stderr, "%c is not a valid difficulty, exiting.\n", selection);
-	exit(EXIT_FAILURE);
+	off = sb.st_size > (off_t)(sizeof(buf) - 1) ?
+	    sb.st_size - (off_t)(sizeof(buf) - 1) : 0;
+	len = pread(fd, buf, sizeof(buf) - 1, off);
+	(void)close(fd);
+	if (len <= 0)
+		return 'e';
+	buf[len] = '\0';
+
+	/* walk the window backwards, newest line first */
+	end = buf + len;
+	while (end > buf && seen < ADAPT_GAMES) {
+		if (end[-1] == '\n') {
+			*--end = '\0';
+			continue;
+		}
+		line = end;
+		while (line > buf && line[-1] != '\n')
+			line--;
+		/* the first line of the window may be cut short */
+		if (line == buf && off > 0)
+			break;
+		end = line;
+
+		if (!parse_score(line, line + strlen(line), v))
+			continue;
+		if (v[0] != mode || (tier != -1 && v[1] != difficulties[tier].diff))
+			continue;
+		for (i = 0; tier == -1 && i < NDIFFICULTIES; i++)
+			if (v[1] == difficulties[i].diff)
+				tier = i;
+		if (tier == -1)
+			continue;
+		seen++;
+
+		if (mode == MODE_ATTEMPTS) {
+			if (v[2] > GUESS_LIMIT * 3 / 4)
+				down++;
+			else if (v[2] <= GUESS_LIMIT / 2)
+				up++;
+		} else {
+			if (v[3] >= TIMELIMIT * 1000)
+				down++;
+			else if (v[3] <= TIMELIMIT * 1000 / 3)
+				up++;
+		}
+	}
+
+	if (seen == 0)
+		return 'e';
+	printf("Adaptive difficulty from your last %d games\n", seen);
+
+	if (up > down && tier < NDIFFICULTIES - 1)
+		tier++;
+	else if (down > up && tier > 0)
+		tier--;
+	return difficulties[tier].selection;
+}
+
+/*
+ * read the game clock in milliseconds
+ * GAME_CLOCK is monotonic so wall clock steps never skew a game, and
+ * can be set to a coarse clock where the per-call cost matters more than
+ * sub-tick resolution
+ */
+static long long
+clock_ms()
+{
+	struct timespec ts;
+
+	if (clock_gettime(GAME_CLOCK, &ts) == -1) {
+		fprintf(stderr, "Error reading clock\n");
+		exit(EXIT_FAILURE);
+	}
+	return (long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
 }
 
 /*
- * write score to a file
+ * write score to a file, with the time in milliseconds
+ * the record is formatted up front and appended with a single write(2)
+ * on an O_APPEND descriptor, so there is no stdio buffering or extra
+ * flush and concurrent games never interleave partial lines. The write
+ * is made under the score file lock, and retried on the new file if an
+ * in-place import replaced the score file while waiting for it
  */
 static void
-write_highscore(int gamemode, int diff, int attempts, int time)
+write_highscore(int gamemode, int diff, int attempts, int ms)
 {
-	FILE *fp = fopen("scores.dat", "a");
+	char buf[SCORE_LINE_MAX];
+	struct stat fsb, sb;
+	int fd, len;
+
+	len = snprintf(buf, sizeof(buf), "%d, %d, %d, %d, %lld\n",
+	    gamemode, diff, attempts, ms, (long long)time(NULL));
+	if (len < 0 || (size_t)len >= sizeof(buf)) {
+		fprintf(stderr, "Error formatting score\n");
+		exit(EXIT_FAILURE);
+	}
+
+	for (;;) {
+		fd = open(SCORE_FILE, O_WRONLY | O_APPEND | O_CREAT, 0644);
+		if (fd == -1 || lock_score_file(fd) == -1 || fstat(fd, &fsb) == -1) {
+			fprintf(stderr, "Error opening file\n");
+			exit(EXIT_FAILURE);
+		}
+		if (stat(SCORE_FILE, &sb) == 0 &&
+		    sb.st_dev == fsb.st_dev && sb.st_ino == fsb.st_ino)
+			break;
+		(void)close(fd);
+	}
+
+	if (write(fd, buf, (size_t)len) != (ssize_t)len) {
+		fprintf(stderr, "Error writing file\n");
+		(void)close(fd);
+		exit(EXIT_FAILURE);
+	}
+	(void)close(fd);
+}
+
+/*
+ * take an exclusive lock on the whole of the score file open on fd,
+ * waiting for any other holder. The lock is released when any of the
+ * process' descriptors for the file is closed
+ * if an error occurs, return -1, else 0
+ */
+static int
+lock_score_file(int fd)
+{
+	struct flock fl;
+
+	memset(&fl, 0, sizeof(fl));
+	fl.l_type = F_WRLCK;
+	fl.l_whence = SEEK_SET;
+	while (fcntl(fd, F_SETLKW, &fl) == -1)
+		if (errno != EINTR)
+			return -1;
+	return 0;
+}
+
+/*
+ * print the scores matching the given gamemode and difficulty
+ * selections, taking at most max_time seconds, from the last days days
+ * a '\0' selection or negative limit matches everything
+ * if an error occurs, return EXIT_FAILURE, else EXIT_SUCCESS
+ */
+static int
+print_scores(char mode_opt, char diff_opt, int max_time, int days)
+{
+	char line[SCORE_LINE_MAX];
+	size_t len;
+	int mode = 0, diff = 0, matched = 0, c;
+	long long v[5], since = 0;
+	FILE *fp;
+
+	if (mode_opt != '\0')
+		mode = select_gamemode(mode_opt);
+	if (diff_opt != '\0')
+		diff = parse_difficulty(diff_opt);
+
+	if (days >= 0)
+		since = (long long)time(NULL) - (long long)days * 24 * 60 * 60;
+
+	fp = fopen(SCORE_FILE, "r");
 	if (fp == NULL) {
 		fprintf(stderr, "Error opening file\n");
-		exit(EXIT_FAILURE);
+		return EXIT_FAILURE;
 	}
 
-	fprintf(fp, "%d, %d, %d, %d\n", gamemode, diff, attempts, time);
+	while (fgets(line, sizeof(line), fp) != NULL) {
+		/* skip the whole of a line too long for the buffer */
+		len = strlen(line);
+		if (len > 0 && line[len - 1] != '\n' && !feof(fp)) {
+			while ((c = getc(fp)) != EOF && c != '\n')
+				;
+			continue;
+		}
+		if (!parse_score(line, line + len, v))
+			continue;
+		if ((mode != 0 && v[0] != mode) || (diff != 0 && v[1] != diff))
+			continue;
+		if ((max_time >= 0 && v[3] > max_time * 1000LL) || v[4] < since)
+			continue;
+		matched++;
+		printf("%lld, %lld, %lld, %lld, %lld\n", v[0], v[1], v[2], v[3], v[4]);
+	}
 	fclose(fp);
+
+	printf("%d matching games\n", matched);
+	return EXIT_SUCCESS;
+}
+
+/*
+ * append the valid scores from an existing score file to SCORE_FILE
+ * lines from before timestamps were recorded have their time converted
+ * from seconds to milliseconds. The file is read and written in
+ * INGEST_BUFSIZE blocks and parsed in place, rather than a line at a time
+ * through stdio. If the file is SCORE_FILE itself, it is converted in
+ * place: the valid scores are written to SCORE_TMP_FILE, which is then
+ * renamed over it, dropping invalid lines. The score file stays locked
+ * until the rename, so games finishing meanwhile wait and then append to
+ * the new file
+ * if an error occurs, return EXIT_FAILURE, else EXIT_SUCCESS
+ */
+static int
+ingest_scores(const char *path)
+{
+	static char in[INGEST_BUFSIZE], out[INGEST_BUFSIZE + SCORE_LINE_MAX];
+	char *line, *nl, *end;
+	struct stat isb, osb;
+	size_t have = 0, outlen = 0;
+	ssize_t n;
+	int ifd, ofd, lfd = -1, len, imported = 0, skipped = 0, discard = 0;
+	int inplace = 0;
+
+	ifd = open(path, O_RDONLY);
+	if (ifd == -1 || fstat(ifd, &isb) == -1) {
+		fprintf(stderr, "Error opening file\n");
+		if (ifd != -1)
+			(void)close(ifd);
+		return EXIT_FAILURE;
+	}
+
+	/* appending to the file being read would never reach its end */
+	if (stat(SCORE_FILE, &osb) == 0 &&
+	    osb.st_dev == isb.st_dev && osb.st_ino == isb.st_ino) {
+		inplace = 1;
+		lfd = open(SCORE_FILE, O_WRONLY);
+		if (lfd == -1 || lock_score_file(lfd) == -1)
+			ofd = -1;
+		else
+			ofd = open(SCORE_TMP_FILE, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	} else {
+		ofd = open(SCORE_FILE, O_WRONLY | O_APPEND | O_CREAT, 0644);
+	}
+	if (ofd == -1) {
+		fprintf(stderr, "Error opening file\n");
+		if (lfd != -1)
+			(void)close(lfd);
+		(void)close(ifd);
+		return EXIT_FAILURE;
+	}
+
+	for (;;) {
+		n = read(ifd, in + have, sizeof(in) - have);
+		if (n == -1) {
+			fprintf(stderr, "Error reading file\n");
+			goto fail;
+		}
+		have += (size_t)n;
+		line = in;
+		end = in + have;
+
+		while ((nl = memchr(line, '\n', (size_t)(end - line))) != NULL ||
+		    (n == 0 && line < end)) {
+			if (nl == NULL)
+				nl = end;
+			if (discard) {
+				/* the rest of an over-long line */
+				discard = 0;
+				line = nl < end ? nl + 1 : end;
+				continue;
+			}
+			len = ingest_line(line, nl, out + outlen, sizeof(out) - outlen);
+			if (len > 0) {
+				outlen += (size_t)len;
+				imported++;
+			} else if (nl > line) {
+				skipped++;
+			}
+			line = nl < end ? nl + 1 : end;
+
+			if (outlen >= INGEST_BUFSIZE) {
+				if (write(ofd, out, outlen) != (ssize_t)outlen) {
+					fprintf(stderr, "Error writing file\n");
+					goto fail;
+				}
+				outlen = 0;
+			}
+		}
+		if (n == 0)
+			break;
+
+		/*
+		 * carry the partial last line over to the next block, or drop
+		 * it up to the next newline if it fills the whole buffer
+		 */
+		have = (size_t)(end - line);
+		if (have == sizeof(in)) {
+			if (!discard)
+				skipped++;
+			discard = 1;
+			have = 0;
+		}
+		memmove(in, line, have);
+	}
+
+	if (outlen > 0 && write(ofd, out, outlen) != (ssize_t)outlen) {
+		fprintf(stderr, "Error writing file\n");
+		goto fail;
+	}
+	/* closing either descriptor for the score file drops the lock */
+	if (close(ofd) == -1 || (inplace && rename(SCORE_TMP_FILE, SCORE_FILE) == -1)) {
+		fprintf(stderr, "Error writing file\n");
+		ofd = -1;
+		goto fail;
+	}
+	(void)close(ifd);
+	if (lfd != -1)
+		(void)close(lfd);
+
+	printf("Imported %d scores, skipped %d invalid lines\n", imported, skipped);
+	return EXIT_SUCCESS;
+
+fail:
+	if (inplace)
+		(void)unlink(SCORE_TMP_FILE);
+	(void)close(ifd);
+	if (ofd != -1)
+		(void)close(ofd);
+	if (lfd != -1)
+		(void)close(lfd);
+	return EXIT_FAILURE;
+}
+
+/*
+ * validate one score line between line and end, and format it into buf
+ * returns the formatted length, or 0 if the line is not a valid score
+ */
+static int
+ingest_line(const char *line, const char *end, char *buf, size_t size)
+{
+	long long v[5];
+	int len;
+
+	if (!parse_score(line, end, v))
+		return 0;
+	if (v[0] != MODE_ATTEMPTS && v[0] != MODE_TIME)
+		return 0;
+	if (lookup_difficulty((int)v[1]) == NULL)
+		return 0;
+	if (v[2] < 1 || v[3] < 0 || v[4] < 0)
+		return 0;
+
+	len = snprintf(buf, size, "%d, %d, %d, %d, %lld\n",
+	    (int)v[0], (int)v[1], (int)v[2], (int)v[3], v[4]);
+	if (len < 0 || (size_t)len >= size)
+		return 0;
+	return len;
+}
+
+/*
+ * parse one score file line between line and end into v: the gamemode,
+ * difficulty, attempts, time in milliseconds and timestamp. Lines from
+ * before timestamps were recorded have four fields with the time in
+ * seconds; their time is converted and their timestamp reads as 0
+ * returns 1 if the line is a score whose first four fields fit in an int,
+ * else 0
+ */
+static int
+parse_score(const char *line, const char *end, long long *v)
+{
+	int fields = 0, i;
+
+	while (fields < 5 && scan_number(&line, end, &v[fields]))
+		fields++;
+	while (line < end && isspace((unsigned char)*line))
+		line++;
+	if (line != end || fields < 4)
+		return 0;
+
+	if (fields == 4) {
+		if (v[3] > INT_MAX / 1000 || v[3] < INT_MIN / 1000)
+			return 0;
+		v[3] *= 1000;
+		v[4] = 0;
+	}
+
+	for (i = 0; i < 4; i++)
+		if (v[i] < INT_MIN || v[i] > INT_MAX)
+			return 0;
+	return 1;
+}
+
+/*
+ * read a comma separated integer at *p, stopping before end
+ * advances *p past it and returns 1, or returns 0 if there is none
+ */
+static int
+scan_number(const char **p, const char *end, long long *value)
+{
+	const char *s = *p;
+	long long v = 0;
+	int neg = 0, digits = 0;
+
+	while (s < end && (*s == ' ' || *s == '\t'))
+		s++;
+	if (s < end && *s == '-') {
+		neg = 1;
+		s++;
+	}
+	for (; s < end && *s >= '0' && *s <= '9' && digits < 18; s++, digits++)
+		v = v * 10 + (*s - '0');
+	if (digits == 0 || (s < end && *s >= '0' && *s <= '9'))
+		return 0;
+
+	while (s < end && (*s == ' ' || *s == '\t'))
+		s++;
+	if (s < end && *s == ',')
+		s++;
+
+	*p = s;
+	*value = neg ? -v : v;
+	return 1;
+}
+
+/*
+ * map a difficulty selection character to its DIFF_* value
+ * without starting a game
+ * exits if the selection is not a valid difficulty
+ */
+static int
+parse_difficulty(char selection)
+{
+	int i;
+
+	for (i = 0; i < NDIFFICULTIES; i++)
+		if (tolower((unsigned char)selection) == difficulties[i].selection)
+			return difficulties[i].diff;
+
+	fprintf(stderr, "%c is not a valid difficulty, exiting.\n", selection);
+	exit(EXIT_FAILURE);
+}
+
+/*
+ * look up the tier for a DIFF_* value
+ * exits if diff is not a valid difficulty
+ */
+static const struct difficulty *
+find_difficulty(int diff)
+{
+	const struct difficulty *d = lookup_difficulty(diff);
+
+	if (d == NULL) {
+		fprintf(stderr, "An unknown error occurred\n");
+		exit(EXIT_FAILURE);
+	}
+	return d;
+}
+
+/*
+ * look up the tier for a DIFF_* value
+ * returns NULL if diff is not a valid difficulty
+ */
+static const struct difficulty *
+lookup_difficulty(int diff)
+{
+	int i;
+
+	for (i = 0; i < NDIFFICULTIES; i++)
+		if (difficulties[i].diff == diff)
+			return &difficulties[i];
+	return NULL;
+}
+
+/*
+ * play simulated games with each strategy at the given difficulty
+ * and print the results as JSON. The answers come from their own stream
+ * seeded with seed, so every strategy plays the same games, and the
+ * strategies' own random guesses are seeded with it too, so runs with
+ * the same seed are directly comparable
+ * if an error occurs, return EXIT_FAILURE, else EXIT_SUCCESS
+ */
+static int
+simulate(char diff_opt, int games, unsigned int seed)
+{
+	int *hist;
+	unsigned int answers;
+	long long begin, elapsed;
+	int diff, max, strategy, game, wins, attempts, total;
+	int p50, p90, p99, worst;
+
+	diff = parse_difficulty(diff_opt != '\0' ? diff_opt : 'e');
+	max = find_difficulty(diff)->max;
+
+	/* a game takes at most max + 1 guesses */
+	hist = calloc((size_t)max + 2, sizeof(*hist));
+	if (hist == NULL) {
+		fprintf(stderr, "Error allocating memory\n");
+		return EXIT_FAILURE;
+	}
+
+	printf("{\"difficulty\": %d, \"max\": %d, \"games\": %d, \"seed\": %u, "
+	    "\"strategies\": [", diff, max, games, seed);
+	for (strategy = 0; strategy < (int)(sizeof(strategies) / sizeof(strategies[0])); strategy++) {
+		memset(hist, 0, ((size_t)max + 2) * sizeof(*hist));
+		srand(seed);
+		answers = seed;
+		wins = 0;
+
+		begin = clock_ms();
+		for (game = 0; game < games; game++) {
+			attempts = simulate_game(max, strategy, &answers);
+			hist[attempts]++;
+			if (attempts <= GUESS_LIMIT)
+				wins++;
+		}
+		elapsed = clock_ms() - begin;
+
+		/* read the attempt percentiles off the histogram */
+		p50 = p90 = p99 = worst = 0;
+		total = 0;
+		for (attempts = 1; attempts <= max + 1; attempts++) {
+			if (hist[attempts] == 0)
+				continue;
+			total += hist[attempts];
+			if (p50 == 0 && total * 100LL >= games * 50LL)
+				p50 = attempts;
+			if (p90 == 0 && total * 100LL >= games * 90LL)
+				p90 = attempts;
+			if (p99 == 0 && total * 100LL >= games * 99LL)
+				p99 = attempts;
+			worst = attempts;
+		}
+
+		printf("%s{\"name\": \"%s\", \"wins\": %d, \"attempts_p50\": %d, "
+		    "\"attempts_p90\": %d, \"attempts_p99\": %d, \"attempts_max\": %d, "
+		    "\"elapsed_ms\": %lld}", strategy > 0 ? ", " : "", strategies[strategy],
+		    wins, p50, p90, p99, worst, elapsed);
+	}
+	printf("]}\n");
+	free(hist);
+	return EXIT_SUCCESS;
+}
+
+/*
+ * play one simulated game with the given strategy on 0-max, drawing
+ * the answer from the rand_r() state in answers
+ * returns the number of guesses taken to find the answer
+ */
+static int
+simulate_game(int max, int strategy, unsigned int *answers)
+{
+	int low = 0, high = max, guess, attempts = 0;
+
+	answer = rand_r(answers) % (max + 1);
+	for (;;) {
+		if (strategy == 0)
+			guess = hint(low, high, -1, NULL);
+		else
+			guess = low + rand() % (high - low + 1);
+		attempts++;
+
+		if (guess < answer)
+			low = guess + 1;
+		else if (guess > answer)
+			high = guess - 1;
+		else
+			return attempts;
+	}
+}
+
+/*
+ * recommend the next guess when the answer is somewhere in low-high
+ * with left guesses remaining, or unlimited guesses if left is negative
+ * the recommendation is the middle of the range. If chance is not NULL,
+ * it is set to the percentage chance of winning from here: k guesses
+ * can find at most 2^k - 1 numbers, so this needs no search or table
+ * returns the recommended guess
+ */
+static int
+hint(int lo, int hi, int left, int *chance)
+{
+	long long n = (long long)hi - lo + 1, found;
+
+	if (chance != NULL) {
+		if (n <= 0)
+			*chance = 0;
+		else if (left < 0 || left >= 62)
+			*chance = 100;
+		else {
+			found = (1LL << left) - 1;
+			*chance = found >= n ? 100 : (int)(found * 100 / n);
+		}
+	}
+	return lo + (hi - lo) / 2;
+}
+
+/*
+ * print a hint for the current range if hints were requested
+ * the chance of winning is left out when guesses are unlimited, as it
+ * would always read 100%
+ */
+static void
+print_hint(int left)
+{
+	int guess, chance;
+
+	if (!hints)
+		return;
+	guess = hint(hint_low, hint_high, left, &chance);
+	if (left < 0)
+		printf("[hint: %d] ", guess);
+	else
+		printf("[hint: %d, %d%% to win] ", guess, chance);
+}
+
+/*
+ * narrow the range the answer can be in after a wrong guess
+ */
+static void
+narrow(int guess)
+{
+	if (guess < answer && guess >= hint_low)
+		hint_low = guess + 1;
+	else if (guess > answer && guess <= hint_high)
+		hint_high = guess - 1;
 }
 
 /*
@@ -330,6 +1072,21 @@ print_help()
 	printf("In easy mode, the number could be anything from 0-%d\n", EASY_MAX);
 	printf("In medium mode, the number could be anything from 0-%d\n", MEDIUM_MAX);
 	printf("In hard mode, the number could be anything from 0-%d\n", HARD_MAX);
+	printf("In adaptive mode, the difficulty is picked from your recent scores\n\n");
+
+	printf("The gamemode and difficulty can be given on the command line with\n");
+	printf("-m and -d to skip the menus, e.g. -m t -d h for a hard time game.\n");
+	printf("-g shows a hint before each guess with the best next guess and your\n");
+	printf("chance of winning from there in attempts mode.\n\n");
+
+	printf("Past scores can be listed with -s, filtered by -m and -d, -t for games\n");
+	printf("taking at most that many seconds and -w for games in the last days.\n\n");
+
+	printf("-b plays that many simulated games with each guessing strategy and prints\n");
+	printf("the results as JSON. -r sets the random seed, so runs can be repeated.\n\n");
+
+	printf("-i adds the valid scores from another score file to %s, or\n", SCORE_FILE);
+	printf("converts old scores in %s itself when given that file.\n", SCORE_FILE);
 }
 
 /*
@@ -338,6 +1095,9 @@ print_help()
 static void
 usage()
 {
-	(void)fprintf(stderr, "Usage: NumberGuesser [-h | -H]\n");
+	(void)fprintf(stderr, "Usage: NumberGuesser [-h | -H] [-g] [-m a|t] [-d e|m|h|a]\n"
+	    "       NumberGuesser -s [-m a|t] [-d e|m|h] [-t seconds] [-w days]\n"
+	    "       NumberGuesser -b games [-d e|m|h] [-r seed]\n"
+	    "       NumberGuesser -i file\n");
 	exit(EXIT_FAILURE);
 }
@@ -29,6 +29,11 @@
 #define TIMELIMIT 25
 #endif
 
+/* Clock used to time games, e.g. CLOCK_MONOTONIC_COARSE on busy servers */
+#ifndef GAME_CLOCK
+#define GAME_CLOCK CLOCK_MONOTONIC
+#endif
+
 /* Return value to represent easy difficulty */
 #ifndef DIFF_EASY
 #define DIFF_EASY 10
@@ -59,6 +64,11 @@
 #define MODE_HELP 30
 #endif
 
+/* Number of guesses allowed in the attempts gamemode */
+#ifndef GUESS_LIMIT
+#define GUESS_LIMIT 10
+#endif
+
 /* Maximum number for easy difficulty */
 #ifndef EASY_MAX
 #define EASY_MAX 100
@@ -88,3 +98,33 @@
 #ifndef HARD_ATTEMPTS
 #define HARD_ATTEMPTS 25
 #endif
+
+/* File that scores are appended to */
+#ifndef SCORE_FILE
+#define SCORE_FILE "scores.dat"
+#endif
+
+/* File the score file is rewritten to when it is imported in place */
+#ifndef SCORE_TMP_FILE
+#define SCORE_TMP_FILE SCORE_FILE ".tmp"
+#endif
+
+/* Maximum length of a single line in the score file */
+#ifndef SCORE_LINE_MAX
+#define SCORE_LINE_MAX 128
+#endif
+
+/* Number of score file lines read back by adaptive difficulty */
+#ifndef ADAPT_WINDOW
+#define ADAPT_WINDOW 32
+#endif
+
+/* Number of recent games adaptive difficulty bases its choice on */
+#ifndef ADAPT_GAMES
+#define ADAPT_GAMES 5
+#endif
+
+/* Size of the blocks a score file is imported in */
+#ifndef INGEST_BUFSIZE
+#define INGEST_BUFSIZE 65536
+#endif